@@ -0,0 +1,141 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Where the time of a run goes: wall time of each stage (generation, fits,
+// plots, output file), throughput and memory. SpinToys fills it with the
+// options "timing" (printout) and "bench=report.json", which also appends
+// the run as one JSON line to the report, the file that SpinBench.C fills
+// to follow the performance from one version or machine to another.
+//
+// Generation and fits are timed inside each experiment, in the thread that
+// runs it, so with threads their times add up the time of all the threads;
+// the wall time of the run and the throughput are those of the whole run.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINBENCH_H
+#define SPINBENCH_H
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include "TROOT.h"
+#include "TSystem.h"
+#include "TDatime.h"
+#include "TString.h"
+#include "SpinStore.h"
+
+enum ESpinStage { kSpinStageGen, kSpinStageFit, kSpinStagePlot, kSpinStageIO, kSpinNStages };
+
+// Seconds of a monotonic wall clock
+inline Double_t SpinClock()
+{
+  return std::chrono::duration<Double_t>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class SpinTiming {
+public:
+  SpinTiming() : fStart(SpinClock()), fWall(0.), fThreads(1), fExps(0), fEvents(0), fFits(0), fObjects(0)
+  {
+    for (Int_t s=0;s<kSpinNStages;s++) { fTime[s] = 0.; fCalls[s] = 0; }
+    ProcInfo_t info;
+    gSystem->GetProcInfo(&info);
+    fMemStart = fMemEnd = info.fMemResident;
+    fMemVirtual = info.fMemVirtual;
+  }
+
+  void Add(ESpinStage s, Double_t seconds) { fTime[s] += seconds; fCalls[s]++; }
+
+  // Generation and fits of one experiment of numEvts events and nfits fits
+  void Add(const SpinExpResult& r, Int_t numEvts, Int_t nfits)
+  {
+    Add(kSpinStageGen,r.tGen);
+    Add(kSpinStageFit,r.tFit);
+    fExps++;
+    fEvents += numEvts;
+    fFits += nfits;
+  }
+
+  // Histograms and functions built (SpinWorker), from any thread
+  void AddObjects(Long64_t n) { fObjects += n; }
+  void SetThreads(Int_t n) { fThreads = n; }
+
+  void Stop()
+  {
+    fWall = SpinClock()-fStart;
+    ProcInfo_t info;
+    gSystem->GetProcInfo(&info);
+    fMemEnd = info.fMemResident;
+    fMemVirtual = info.fMemVirtual;
+  }
+
+  void Print() const
+  {
+    const char* name[kSpinNStages] = {"generation","fits","plots","output file"};
+    printf("\nTiming: %.3f s for %lld experiments on %d threads\n",fWall,fExps,fThreads);
+    for (Int_t s=0;s<kSpinNStages;s++) {
+      if (fCalls[s]==0) continue;
+      printf("  %-12s %10.3f s %10lld calls %12.2f us/call\n",name[s],fTime[s],fCalls[s],1e6*fTime[s]/fCalls[s]);
+    }
+    printf("  %.4g events/s, %.4g fits/s, %.4g experiments/s\n",Rate(fEvents),Rate(fFits),Rate(fExps));
+    printf("  memory %ld kB resident (%+ld kB in the run), %lld histograms and functions built\n",fMemEnd,fMemEnd-fMemStart,fObjects.load());
+  }
+
+  // Appends the run as one JSON line to fileName. run describes the settings (SpinRunTitle).
+  Bool_t Write(const char* fileName, const char* run, Int_t numEvts, const char* option) const
+  {
+    FILE* f = fopen(fileName,"a");
+    if (!f) {
+      printf("Cannot open %s\n",fileName);
+      return kFALSE;
+    }
+    const char* key[kSpinNStages] = {"gen","fit","plot","io"};
+    TDatime now;
+    fprintf(f,"{\"date\": \"%s\", \"host\": ",now.AsSQLString());
+    JsonString(f,gSystem->HostName());
+    fprintf(f,", \"root\": ");
+    JsonString(f,gROOT->GetVersion());
+    fprintf(f,", \"run\": ");
+    JsonString(f,run);
+    fprintf(f,", \"option\": ");
+    JsonString(f,option);
+    fprintf(f,", ");
+    fprintf(f,"\"threads\": %d, \"experiments\": %lld, \"numEvts\": %d, \"wall_s\": %.6f, ",fThreads,fExps,numEvts,fWall);
+    for (Int_t s=0;s<kSpinNStages;s++) fprintf(f,"\"%s_s\": %.6f, \"%s_calls\": %lld, ",key[s],fTime[s],key[s],fCalls[s]);
+    fprintf(f,"\"events_per_s\": %.6g, \"fits_per_s\": %.6g, \"experiments_per_s\": %.6g, ",Rate(fEvents),Rate(fFits),Rate(fExps));
+    fprintf(f,"\"objects\": %lld, \"mem_resident_kb\": %ld, \"mem_growth_kb\": %ld, \"mem_virtual_kb\": %ld}\n",
+            fObjects.load(),fMemEnd,fMemEnd-fMemStart,fMemVirtual);
+    fclose(f);
+    return kTRUE;
+  }
+
+private:
+  Double_t Rate(Long64_t n) const { return fWall>0. ? n/fWall : 0.; }
+
+  // s as a JSON string: quotes, backslashes and control characters escaped
+  static void JsonString(FILE* f, const char* s)
+  {
+    fputc('"',f);
+    for (;s && *s;s++) {
+      unsigned char c = *s;
+      if (c=='"' || c=='\\') fprintf(f,"\\%c",c);
+      else if (c<0x20) fprintf(f,"\\u%04x",c);
+      else fputc(c,f);
+    }
+    fputc('"',f);
+  }
+
+  Double_t fStart;
+  Double_t fWall;
+  Int_t fThreads;
+  Double_t fTime[kSpinNStages];
+  Long64_t fCalls[kSpinNStages];
+  Long64_t fExps;
+  Long64_t fEvents;
+  Long64_t fFits;
+  std::atomic<Long64_t> fObjects;
+  Long_t fMemStart;
+  Long_t fMemEnd;
+  Long_t fMemVirtual;
+};
+
+#endif
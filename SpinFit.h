@@ -0,0 +1,470 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Fitter for the spin pdfs of one case against a histogram, without the
+// TH1::Fit machinery. Same model as TH1::Fit(pdf,"R"): normalization times
+// the pdf at the bin centres, chi2 with sqrt(n) errors over the non-empty
+// bins, or the Poisson likelihood (Baker-Cousins chi2) over all the bins.
+//
+// The pdfs are linear in the shape parameters except for b369 pdf3, so in
+// (N, N*beta) the chi2 fit is a weighted linear least squares problem with
+// an exact solution. The likelihood fit and the non linear pdfs use Newton
+// iterations with exact derivatives, the likelihood starting from the chi2
+// minimum. Errors come from the full Hessian at the minimum, as HESSE does.
+// A fit that cannot be done (the likelihood of a pdf that is negative in a
+// bin for every start) or does not converge is reported in its status.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINFIT_H
+#define SPINFIT_H
+
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "TMath.h"
+#include "SpinPdf.h"
+
+const Int_t kSpinMaxBins = 100;
+
+// Status of a fit
+enum ESpinFitStatus {
+  kSpinFitOk = 0,
+  kSpinFitInvalid = 1,     // the likelihood is not defined (pdf not positive in some bin) at any start
+  kSpinFitNoConverge = 2   // the iterations stopped before reaching the minimum
+};
+
+struct SpinFitResult {
+  Int_t status;            // ESpinFitStatus (or the status of TH1::Fit); chi2 and pvalue are NaN if invalid
+  Double_t chi2;
+  Int_t ndof;
+  Double_t pvalue;
+  Double_t par[kSpinMaxPar];
+  Double_t err[kSpinMaxPar];
+};
+
+// Marks fr as a fit without result (the pdf is not positive in a bin where it has to be)
+inline void SpinFitInvalid(SpinFitResult& fr)
+{
+  fr.status = kSpinFitInvalid;
+  fr.chi2 = fr.pvalue = TMath::QuietNaN();
+}
+
+// Solves A x = b (n<=kSpinMaxPar) by Gauss-Jordan with partial pivoting; A is replaced by its inverse
+inline Bool_t SpinSolve(Int_t n, Double_t A[kSpinMaxPar][kSpinMaxPar], Double_t* b)
+{
+  Double_t inv[kSpinMaxPar][kSpinMaxPar];
+  for (Int_t i=0;i<n;i++)
+    for (Int_t j=0;j<n;j++) inv[i][j] = (i==j);
+  for (Int_t col=0;col<n;col++) {
+    Int_t piv = col;
+    for (Int_t r=col+1;r<n;r++)
+      if (fabs(A[r][col])>fabs(A[piv][col])) piv = r;
+    if (A[piv][col]==0.) return kFALSE;
+    if (piv!=col) {
+      for (Int_t j=0;j<n;j++) {
+        std::swap(A[piv][j],A[col][j]);
+        std::swap(inv[piv][j],inv[col][j]);
+      }
+      std::swap(b[piv],b[col]);
+    }
+    Double_t d = A[col][col];
+    for (Int_t j=0;j<n;j++) { A[col][j] /= d; inv[col][j] /= d; }
+    b[col] /= d;
+    for (Int_t r=0;r<n;r++) {
+      if (r==col) continue;
+      Double_t f = A[r][col];
+      if (f==0.) continue;
+      for (Int_t j=0;j<n;j++) { A[r][j] -= f*A[col][j]; inv[r][j] -= f*inv[col][j]; }
+      b[r] -= f*b[col];
+    }
+  }
+  for (Int_t i=0;i<n;i++)
+    for (Int_t j=0;j<n;j++) A[i][j] = inv[i][j];
+  return kTRUE;
+}
+
+// Newton step = -H^-1 grad. Where H is not positive definite (away from the minimum or near a
+// fold of the parameters, where the plain Newton step leads to the saddle point) the diagonal is
+// raised, H + lambda*diag(H) with lambda growing until it is (Marquardt). Returns the expected
+// decrease of the function along the step (edm), -1 if there is no such step.
+inline Double_t SpinNewtonStep(Int_t n, Double_t H[kSpinMaxPar][kSpinMaxPar], const Double_t* grad, Double_t* step)
+{
+  for (Double_t lambda=0.;lambda<1e12;lambda=(lambda>0. ? 10.*lambda : 1e-3)) {
+    // Cholesky decomposition A = L L^T, which exists only for A positive definite
+    Double_t L[kSpinMaxPar][kSpinMaxPar];
+    Bool_t positive = kTRUE;
+    for (Int_t a=0;a<n && positive;a++)
+      for (Int_t b=0;b<=a;b++) {
+        Double_t s = H[a][b] + (a==b ? lambda*(fabs(H[a][a])+1e-12) : 0.);
+        for (Int_t k=0;k<b;k++) s -= L[a][k]*L[b][k];
+        if (a==b) {
+          if (!(s>0.)) { positive = kFALSE; break; }
+          L[a][a] = sqrt(s);
+        } else L[a][b] = s/L[b][b];
+      }
+    if (!positive) continue;
+    for (Int_t a=0;a<n;a++) {  // L y = -grad, L^T step = y
+      step[a] = -grad[a];
+      for (Int_t k=0;k<a;k++) step[a] -= L[a][k]*step[k];
+      step[a] /= L[a][a];
+    }
+    for (Int_t a=n-1;a>=0;a--) {
+      for (Int_t k=a+1;k<n;k++) step[a] -= L[k][a]*step[k];
+      step[a] /= L[a][a];
+    }
+    Double_t edm = 0.;
+    for (Int_t a=0;a<n;a++) edm -= 0.5*step[a]*grad[a];
+    return edm;
+  }
+  return -1.;
+}
+
+// Coefficients at par and their derivatives with respect to the free parameters par[free[j]].
+// The coefficients are at most quadratic in the parameters, so central differences of step 1
+// give the derivatives exactly.
+inline void SpinCoefDerivs(const SpinPdf& pdf, const Double_t* p, const Int_t* free, Int_t nfree, Double_t* c,
+                           Double_t dc[kSpinMaxPar][kSpinMaxDeg+1], Double_t d2c[kSpinMaxPar][kSpinMaxPar][kSpinMaxDeg+1])
+{
+  Double_t par[kSpinMaxPar];
+  std::copy(p,p+kSpinMaxPar,par);
+  SpinCoef(pdf,par,c);
+  Double_t cp[kSpinMaxDeg+1], cm[kSpinMaxDeg+1], cpp[kSpinMaxDeg+1], cpm[kSpinMaxDeg+1], cmp[kSpinMaxDeg+1], cmm[kSpinMaxDeg+1];
+  for (Int_t j=0;j<nfree;j++) {
+    Int_t a = free[j];
+    par[a] += 1.; SpinCoef(pdf,par,cp);
+    par[a] -= 2.; SpinCoef(pdf,par,cm);
+    par[a] += 1.;
+    for (Int_t k=0;k<=kSpinMaxDeg;k++) {
+      dc[j][k] = 0.5*(cp[k]-cm[k]);
+      d2c[j][j][k] = cp[k]-2.*c[k]+cm[k];
+    }
+    for (Int_t l=0;l<j;l++) {
+      Int_t b = free[l];
+      par[a] += 1.; par[b] += 1.; SpinCoef(pdf,par,cpp);
+      par[b] -= 2.; SpinCoef(pdf,par,cpm);
+      par[a] -= 2.; SpinCoef(pdf,par,cmm);
+      par[b] += 2.; SpinCoef(pdf,par,cmp);
+      par[a] += 1.; par[b] -= 1.;
+      for (Int_t k=0;k<=kSpinMaxDeg;k++) d2c[j][l][k] = d2c[l][j][k] = 0.25*(cpp[k]-cpm[k]-cmp[k]+cmm[k]);
+    }
+  }
+}
+
+class SpinFitter {
+public:
+  SpinFitter() : fNpdf(0), fNbins(0), fLikelihood(kFALSE) {}
+
+  // Free shape parameters are the ones of SpinParFree, the others stay at parFixed
+  SpinFitter(const SpinCase& sc, Bool_t doFitpol, Bool_t likelihood, Int_t nbins, Double_t xmin, Double_t xmax)
+    : fNpdf(sc.npdf), fNbins(nbins), fLikelihood(likelihood), fParStart(sc.parStart)
+  {
+    assert(nbins<=kSpinMaxBins);
+    fX.resize(nbins*(kSpinMaxDeg+1));
+    for (Int_t i=0;i<nbins;i++) {
+      Double_t x = xmin + (i+0.5)*(xmax-xmin)/nbins, xk = 1.;
+      for (Int_t k=0;k<=kSpinMaxDeg;k++) { fX[i*(kSpinMaxDeg+1)+k] = xk; xk *= x; }
+    }
+    for (Int_t ip=0;ip<fNpdf;ip++) {
+      Hyp& h = fHyp[ip];
+      h.pdf = &sc.pdf[ip];
+      h.nfree = 0;
+      h.par[0] = 1.;
+      for (Int_t k=1;k<kSpinMaxPar;k++) {
+        h.par[k] = sc.parFixed;
+        if (SpinParFree(sc,*h.pdf,k,doFitpol)) {
+          h.par[k] = 0.;
+          h.free[h.nfree++] = k;
+        }
+      }
+      // affine in the free parameters: c(p) = c0 + sum_j p_j d_j, checked on c(e_j+e_l)
+      Double_t c0[kSpinMaxDeg+1], d[kSpinMaxPar][kSpinMaxDeg+1], c[kSpinMaxDeg+1], par[kSpinMaxPar];
+      SpinCoef(*h.pdf,h.par,c0);
+      for (Int_t j=0;j<h.nfree;j++) {
+        std::copy(h.par,h.par+kSpinMaxPar,par);
+        par[h.free[j]] = 1.;
+        SpinCoef(*h.pdf,par,d[j]);
+        for (Int_t k=0;k<=kSpinMaxDeg;k++) d[j][k] -= c0[k];
+      }
+      h.linear = kTRUE;
+      for (Int_t j=0;j<h.nfree;j++)
+        for (Int_t l=j;l<h.nfree;l++) {
+          std::copy(h.par,h.par+kSpinMaxPar,par);
+          par[h.free[j]] += 1.;
+          par[h.free[l]] += 1.;
+          SpinCoef(*h.pdf,par,c);
+          for (Int_t k=0;k<=kSpinMaxDeg;k++) {
+            Double_t expect = c0[k]+d[j][k]+d[l][k];
+            if (fabs(c[k]-expect)>1e-12*(1.+fabs(expect))) h.linear = kFALSE;
+          }
+        }
+      // design of the linear problem: a(x_i) and b_j(x_i) at the bin centres
+      if (h.linear) {
+        h.basis.resize(nbins*(h.nfree+1));
+        for (Int_t i=0;i<nbins;i++) {
+          h.basis[i*(h.nfree+1)] = Dot(i,c0);
+          for (Int_t j=0;j<h.nfree;j++) h.basis[i*(h.nfree+1)+j+1] = Dot(i,d[j]);
+        }
+      }
+    }
+  }
+
+  Int_t GetNpdf() const { return fNpdf; }
+
+  // Fits all the pdfs to the bin contents. The chi2 normal equations of every linear pdf are
+  // accumulated in the same pass over the bins; norm is the starting normalization.
+  void Fit(const Double_t* counts, Double_t norm, SpinFitResult* res) const
+  {
+    Double_t M[kSpinMaxPdf][kSpinMaxPar][kSpinMaxPar] = {{{0.}}};
+    Double_t r[kSpinMaxPdf][kSpinMaxPar] = {{0.}};
+    Double_t nn = 0.;
+    Int_t nonempty = 0;
+    for (Int_t i=0;i<fNbins;i++) {
+      Double_t n = counts[i];
+      if (n<=0.) continue;
+      Double_t w = 1./n;
+      nn += n;
+      nonempty++;
+      for (Int_t ip=0;ip<fNpdf;ip++) {
+        const Hyp& h = fHyp[ip];
+        if (!h.linear) continue;
+        const Double_t* v = &h.basis[i*(h.nfree+1)];
+        for (Int_t a=0;a<=h.nfree;a++) {
+          r[ip][a] += w*v[a]*n;
+          for (Int_t b=0;b<=a;b++) M[ip][a][b] += w*v[a]*v[b];
+        }
+      }
+    }
+
+    for (Int_t ip=0;ip<fNpdf;ip++) {
+      const Hyp& h = fHyp[ip];
+      SpinFitResult& fr = res[ip];
+      Int_t nq = h.nfree+1;
+      Double_t q[kSpinMaxPar];
+      q[0] = norm;
+      for (Int_t j=0;j<h.nfree;j++) q[j+1] = fParStart;
+      Bool_t solved = kFALSE;
+      if (h.linear) {
+        Double_t A[kSpinMaxPar][kSpinMaxPar], theta[kSpinMaxPar];
+        for (Int_t a=0;a<nq;a++) {
+          theta[a] = r[ip][a];
+          for (Int_t b=0;b<=a;b++) A[a][b] = A[b][a] = M[ip][a][b];
+        }
+        if (SpinSolve(nq,A,theta) && theta[0]>0.) {
+          // (N, N*p) -> (N, p), errors from cov = G A^-1 G^T with G = d(N,p)/d(N,N*p)
+          q[0] = theta[0];
+          for (Int_t j=1;j<nq;j++) q[j] = theta[j]/theta[0];
+          if (!fLikelihood) {
+            Double_t G[kSpinMaxPar][kSpinMaxPar] = {{0.}};
+            G[0][0] = 1.;
+            for (Int_t j=1;j<nq;j++) { G[j][0] = -q[j]/q[0]; G[j][j] = 1./q[0]; }
+            Double_t cov[kSpinMaxPar][kSpinMaxPar];
+            for (Int_t a=0;a<nq;a++)
+              for (Int_t b=0;b<nq;b++) {
+                cov[a][b] = 0.;
+                for (Int_t k=0;k<nq;k++)
+                  for (Int_t l=0;l<nq;l++) cov[a][b] += G[a][k]*A[k][l]*G[b][l];
+              }
+            Double_t chi2 = nn;
+            for (Int_t a=0;a<nq;a++) chi2 -= theta[a]*r[ip][a];
+            Store(h,q,cov,chi2>0. ? chi2 : 0.,nonempty-nq,kSpinFitOk,fr);
+            solved = kTRUE;
+          }
+        }
+      }
+      if (!solved) {
+        // The likelihood needs a pdf positive in every bin from the start: the chi2 minimum (found
+        // above for the linear pdfs) or, if the pdf is not positive there, parStart
+        if (fLikelihood) {
+          if (!h.linear) Minimize(h,counts,q,nonempty,kFALSE,fr);
+          if (Eval(h,counts,q,kTRUE,0,0)==TMath::Infinity()) {
+            q[0] = norm;
+            for (Int_t j=0;j<h.nfree;j++) q[j+1] = fParStart;
+          }
+        }
+        Minimize(h,counts,q,nonempty,fLikelihood,fr);
+      }
+    }
+  }
+
+  // Baker-Cousins chi2 of the pdfs with the normalization and the parameters fixed (TH1::Chisquare(pdf,"L"))
+  void NoFit(const Double_t* counts, Double_t norm, SpinFitResult* res) const
+  {
+    for (Int_t ip=0;ip<fNpdf;ip++) {
+      const Hyp& h = fHyp[ip];
+      SpinFitResult& fr = res[ip];
+      std::copy(h.par,h.par+kSpinMaxPar,fr.par);
+      for (Int_t j=0;j<h.nfree;j++) fr.par[h.free[j]] = fParStart;
+      fr.par[0] = norm;
+      fr.chi2 = Chisquare(ip,counts,fr.par);
+      fr.ndof = fNbins;
+      fr.pvalue = TMath::Prob(fr.chi2,fr.ndof);
+      fr.status = kSpinFitOk;
+      if (fr.chi2==TMath::Infinity()) SpinFitInvalid(fr);
+      for (Int_t k=0;k<kSpinMaxPar;k++) fr.err[k] = 0.;
+    }
+  }
+
+  // Baker-Cousins chi2 of pdf ip with parameters par (par[0] the normalization) over all the bins,
+  // infinity if the pdf is not positive in a bin with entries
+  Double_t Chisquare(Int_t ip, const Double_t* counts, const Double_t* par) const
+  {
+    Double_t c[kSpinMaxDeg+1];
+    SpinCoef(*fHyp[ip].pdf,par,c);
+    Double_t chi2 = 0.;
+    for (Int_t i=0;i<fNbins;i++) chi2 += BakerCousins(counts[i],par[0]*Dot(i,c));
+    return chi2;
+  }
+
+private:
+  struct Hyp {
+    const SpinPdf* pdf;
+    Int_t nfree;
+    Int_t free[kSpinMaxPar];     // indices of the free shape parameters
+    Double_t par[kSpinMaxPar];   // fixed values (free ones at 0)
+    Bool_t linear;
+    std::vector<Double_t> basis; // nbins x (nfree+1)
+  };
+
+  Int_t fNpdf;
+  Int_t fNbins;
+  Bool_t fLikelihood;
+  Double_t fParStart;
+  Hyp fHyp[kSpinMaxPdf];
+  std::vector<Double_t> fX;      // powers of the bin centres
+
+  Double_t Dot(Int_t i, const Double_t* c) const
+  {
+    const Double_t* x = &fX[i*(kSpinMaxDeg+1)];
+    Double_t s = 0.;
+    for (Int_t k=0;k<=kSpinMaxDeg;k++) s += c[k]*x[k];
+    return s;
+  }
+
+  static Double_t BakerCousins(Double_t n, Double_t mu)
+  {
+    if (mu<=0.) return n>0. ? TMath::Infinity() : 0.;
+    Double_t t = 2.*(mu-n);
+    if (n>0.) t += 2.*n*log(n/mu);
+    return t;
+  }
+
+  // chi2 or -2lnL (likelihood) at q=(N,free pars), with gradient and Hessian if grad!=0. Where the
+  // likelihood is not defined it returns infinity, with gradient and Hessian 0.
+  Double_t Eval(const Hyp& h, const Double_t* counts, const Double_t* q, Bool_t likelihood, Double_t* grad, Double_t H[kSpinMaxPar][kSpinMaxPar]) const
+  {
+    const Int_t nq = h.nfree+1;
+    Double_t par[kSpinMaxPar], c[kSpinMaxDeg+1];
+    std::copy(h.par,h.par+kSpinMaxPar,par);
+    par[0] = 1.;
+    for (Int_t j=0;j<h.nfree;j++) par[h.free[j]] = q[j+1];
+    Double_t dc[kSpinMaxPar][kSpinMaxDeg+1], d2c[kSpinMaxPar][kSpinMaxPar][kSpinMaxDeg+1];
+    if (!grad) SpinCoef(*h.pdf,par,c);
+    else {
+      SpinCoefDerivs(*h.pdf,par,h.free,h.nfree,c,dc,d2c);
+      for (Int_t a=0;a<nq;a++) {
+        grad[a] = 0.;
+        for (Int_t b=0;b<nq;b++) H[a][b] = 0.;
+      }
+    }
+    const Double_t N = q[0];
+    if (likelihood)
+      for (Int_t i=0;i<fNbins;i++)
+        if (!(N*Dot(i,c)>0.)) return TMath::Infinity();
+    Double_t f = 0.;
+    for (Int_t i=0;i<fNbins;i++) {
+      Double_t n = counts[i];
+      if (!likelihood && n<=0.) continue;
+      Double_t g = Dot(i,c), mu = N*g;
+      Double_t d1, d2;  // derivatives of the bin term with respect to mu
+      if (likelihood) {
+        f += BakerCousins(n,mu);
+        d1 = 2.*(1.-n/mu);
+        d2 = 2.*n/(mu*mu);
+      } else {
+        f += (n-mu)*(n-mu)/n;
+        d1 = -2.*(n-mu)/n;
+        d2 = 2./n;
+      }
+      if (!grad) continue;
+      Double_t dmu[kSpinMaxPar], gj[kSpinMaxPar];
+      dmu[0] = g;
+      for (Int_t j=0;j<h.nfree;j++) { gj[j] = Dot(i,dc[j]); dmu[j+1] = N*gj[j]; }
+      for (Int_t a=0;a<nq;a++) {
+        grad[a] += d1*dmu[a];
+        for (Int_t b=0;b<=a;b++) H[a][b] += d2*dmu[a]*dmu[b];
+      }
+      for (Int_t j=0;j<h.nfree;j++) {
+        H[j+1][0] += d1*gj[j];
+        for (Int_t l=0;l<=j;l++) H[j+1][l+1] += d1*N*Dot(i,d2c[j][l]);
+      }
+    }
+    if (grad)
+      for (Int_t a=0;a<nq;a++)
+        for (Int_t b=a+1;b<nq;b++) H[a][b] = H[b][a];
+    return f;
+  }
+
+  // Damped Newton iterations from q, left at the minimum
+  void Minimize(const Hyp& h, const Double_t* counts, Double_t* q, Int_t nonempty, Bool_t likelihood, SpinFitResult& fr) const
+  {
+    const Int_t nq = h.nfree+1;
+    const Int_t ndof = (likelihood ? fNbins : nonempty)-nq;
+    Double_t grad[kSpinMaxPar], H[kSpinMaxPar][kSpinMaxPar];
+    Double_t cov[kSpinMaxPar][kSpinMaxPar], dummy[kSpinMaxPar] = {0.};
+    Double_t f = Eval(h,counts,q,likelihood,grad,H);
+    if (f==TMath::Infinity()) {
+      for (Int_t a=0;a<nq;a++)
+        for (Int_t b=0;b<nq;b++) cov[a][b] = 0.;
+      Store(h,q,cov,f,ndof,kSpinFitInvalid,fr);
+      SpinFitInvalid(fr);
+      return;
+    }
+    Int_t status = kSpinFitNoConverge;
+    for (Int_t it=0;it<100;it++) {
+      Double_t step[kSpinMaxPar];
+      Double_t edm = SpinNewtonStep(nq,H,grad,step);
+      if (edm<0.) break;
+      Double_t t = 1., fnew = f, qnew[kSpinMaxPar];
+      for (Int_t ls=0;ls<30;ls++,t*=0.5) {
+        for (Int_t a=0;a<nq;a++) qnew[a] = q[a]+t*step[a];
+        fnew = Eval(h,counts,qnew,likelihood,0,0);
+        if (fnew<=f) break;
+      }
+      if (fnew>f) {  // no decrease left along the Newton direction
+        status = kSpinFitOk;
+        break;
+      }
+      std::copy(qnew,qnew+nq,q);
+      f = Eval(h,counts,q,likelihood,grad,H);
+      if (edm<1e-12*(1.+f)) {
+        status = kSpinFitOk;
+        break;
+      }
+    }
+    for (Int_t a=0;a<nq;a++)
+      for (Int_t b=0;b<nq;b++) cov[a][b] = 0.5*H[a][b];
+    if (!SpinSolve(nq,cov,dummy))
+      for (Int_t a=0;a<nq;a++)
+        for (Int_t b=0;b<nq;b++) cov[a][b] = 0.;
+    Store(h,q,cov,f,ndof,status,fr);
+  }
+
+  void Store(const Hyp& h, const Double_t* q, Double_t cov[kSpinMaxPar][kSpinMaxPar], Double_t chi2, Int_t ndof, Int_t status, SpinFitResult& fr) const
+  {
+    fr.status = status;
+    std::copy(h.par,h.par+kSpinMaxPar,fr.par);
+    for (Int_t k=0;k<kSpinMaxPar;k++) fr.err[k] = 0.;
+    fr.par[0] = q[0];
+    fr.err[0] = sqrt(fabs(cov[0][0]));
+    for (Int_t j=0;j<h.nfree;j++) {
+      fr.par[h.free[j]] = q[j+1];
+      fr.err[h.free[j]] = sqrt(fabs(cov[j+1][j+1]));
+    }
+    fr.chi2 = chi2;
+    fr.ndof = ndof;
+    fr.pvalue = TMath::Prob(chi2,ndof);
+  }
+};
+
+#endif
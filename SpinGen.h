@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Event generation for the spin pdfs: binned (multinomial or Poisson
+// per bin) and unbinned (inverse of the tabulated cumulative)
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINGEN_H
+#define SPINGEN_H
+
+#include <vector>
+#include <random>
+#include "TRandom.h"
+#include "SpinPdf.h"
+
+enum ESpinGen {
+  kSpinGenTF1,       // TF1::GetRandom event by event, as FillRandom did
+  kSpinGenBinned,    // one multinomial draw of the bin contents (numEvts fixed)
+  kSpinGenPoisson,   // one Poisson draw per bin (extended, numEvts fluctuates)
+  kSpinGenUnbinned   // individual cos(theta) values from SpinSampler
+};
+
+// Integral of the normalized polynomial between a and b
+inline Double_t SpinIntegral(const Double_t* c, Int_t deg, Double_t a, Double_t b)
+{
+  Double_t C[kSpinMaxDeg+1];
+  for (Int_t k=0;k<=deg;k++) C[k] = c[k]/(k+1);
+  return b*SpinPoly(C,deg,b) - a*SpinPoly(C,deg,a);
+}
+
+// Probability of each bin of [xmin,xmax] for the pdf with parameters par
+inline void SpinBinProb(const SpinPdf& pdf, const Double_t* par, Int_t nbins, Double_t xmin, Double_t xmax, Double_t* prob)
+{
+  Double_t c[kSpinMaxDeg+1];
+  SpinCoef(pdf,par,c);
+  Double_t total = SpinIntegral(c,pdf.deg,xmin,xmax);
+  Double_t width = (xmax-xmin)/nbins;
+  for (Int_t i=0;i<nbins;i++)
+    prob[i] = SpinIntegral(c,pdf.deg,xmin+i*width,xmin+(i+1)*width)/total;
+}
+
+// Lets the <random> distributions draw from a TRandom stream
+struct SpinRngBits {
+  typedef UInt_t result_type;
+  TRandom* rng;
+  SpinRngBits(TRandom& r) : rng(&r) {}
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return 0xFFFFFFFFu; }
+  result_type operator()() { return (result_type)(rng->Rndm()*4294967296.); }
+};
+
+// Bin contents of n events as a chain of conditional binomials, O(nbins) whatever n.
+// TRandom::Binomial loops over the n trials, std::binomial_distribution does not.
+inline void SpinMultinomial(TRandom& rng, Int_t n, const Double_t* prob, Int_t nbins, Double_t* counts)
+{
+  SpinRngBits bits(rng);
+  Double_t rest = 1.;
+  for (Int_t i=0;i<nbins-1;i++) {
+    Double_t p = rest>0. ? prob[i]/rest : 1.;
+    Int_t k = 0;
+    if (n>0 && p>0.) {
+      if (p>=1.) k = n;
+      else k = std::binomial_distribution<Int_t>(n,p)(bits);
+    }
+    counts[i] = k;
+    n -= k;
+    rest -= prob[i];
+  }
+  counts[nbins-1] = n;
+}
+
+// Bin contents with a Poisson number of events of mean nmean
+inline void SpinPoissonBins(TRandom& rng, Double_t nmean, const Double_t* prob, Int_t nbins, Double_t* counts)
+{
+  for (Int_t i=0;i<nbins;i++) counts[i] = rng.Poisson(nmean*prob[i]);
+}
+
+// Unbinned generation: quantiles of the pdf at npoints equally spaced values of the cumulative,
+// found once by bisection of the exact integral. Each event is then one uniform number and a
+// linear interpolation, without search.
+class SpinSampler {
+public:
+  SpinSampler() {}
+  SpinSampler(const SpinPdf& pdf, const Double_t* par, Double_t xmin=-1., Double_t xmax=1., Int_t npoints=4096)
+  {
+    Double_t c[kSpinMaxDeg+1];
+    SpinCoef(pdf,par,c);
+    Double_t total = SpinIntegral(c,pdf.deg,xmin,xmax);
+    fQ.resize(npoints);
+    fQ[0] = xmin;
+    fQ[npoints-1] = xmax;
+    Double_t lo = xmin;
+    for (Int_t i=1;i<npoints-1;i++) {
+      Double_t u = total*i/(npoints-1);
+      Double_t a = lo, b = xmax;
+      for (Int_t it=0;it<52;it++) {
+        Double_t m = 0.5*(a+b);
+        if (SpinIntegral(c,pdf.deg,xmin,m)<u) a = m; else b = m;
+      }
+      fQ[i] = lo = 0.5*(a+b);
+    }
+  }
+
+  Double_t operator()(TRandom& rng) const
+  {
+    Double_t u = rng.Rndm()*(fQ.size()-1);
+    Int_t i = (Int_t)u;
+    return fQ[i] + (u-i)*(fQ[i+1]-fQ[i]);
+  }
+
+  void Sample(TRandom& rng, Int_t n, Double_t* x) const
+  {
+    for (Int_t i=0;i<n;i++) x[i] = (*this)(rng);
+  }
+
+private:
+  std::vector<Double_t> fQ;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Spin PDFs as compiled polynomial kernels in cos(theta) and the table
+// of hypothesis cases studied in the TFG (Ana Belen)
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINPDF_H
+#define SPINPDF_H
+
+#include <string.h>
+#include "Rtypes.h"
+
+const Int_t kSpinMaxDeg = 5;  // highest power of cos(theta) (pdf3 of AnalysisOmega)
+const Int_t kSpinMaxPar = 3;  // [0] normalization, [1] and [2] shape parameters (beta, pol)
+const Int_t kSpinMaxPdf = 3;
+
+// Fills the coefficients c[0..deg] of the polynomial in x=cos(theta) (normalized to 1)
+// from the TF1-like parameter array (par[0] is the normalization and is not used here).
+// The coefficients must be at most quadratic in the shape parameters (SpinFitter relies on it).
+typedef void (*SpinCoefFn)(const Double_t* par, Double_t* c);
+
+struct SpinPdf {
+  const char* name;    // pdf1, pdf2, ...
+  const char* legend;
+  Int_t deg;           // degree of the polynomial in cos(theta)
+  Int_t npar;          // number of parameters, [0] included
+  SpinCoefFn coef;
+};
+
+struct SpinCase {
+  const char* name;     // case label used on the command line (b147, c123, ...)
+  const char* section;  // section of the TFG
+  const char* xtitle;   // axis title of the plots
+  const char* prefix;   // prefix of the per-experiment plot files
+  const char* parName;  // name of the shape parameters in the printout (beta, pol)
+  Int_t numExps;        // default number of experiments and of events/experiment
+  Int_t numEvts;
+  Bool_t doFit;         // default fit settings of the analysis macro of the case
+  Bool_t doFitpol;
+  Double_t parStart;    // starting value of the free shape parameters
+  Double_t parFixed;    // value of the shape parameters when they are not fitted (also used to generate)
+                        // and of the constants after the npar parameters of a pdf
+  Bool_t canFix;        // doFitpol=kFALSE fixes the shape parameters at parFixed. kFALSE for b258 and
+                        // b369, whose macros fitted pol anyway and only left out its averages
+  Int_t gen;            // index of the pdf used to generate the events
+  Int_t npdf;
+  SpinPdf pdf[kSpinMaxPdf];
+};
+
+// Polynomial evaluation with the degree known at compile time, so that the loop is fully unrolled
+template <Int_t Deg>
+inline Double_t SpinHorner(const Double_t* c, Double_t x)
+{
+  Double_t y = c[Deg];
+  for (Int_t k=Deg-1;k>=0;k--) y = y*x + c[k];
+  return y;
+}
+
+inline Double_t SpinPoly(const Double_t* c, Int_t deg, Double_t x)
+{
+  switch (deg) {
+  case 0: return SpinHorner<0>(c,x);
+  case 1: return SpinHorner<1>(c,x);
+  case 2: return SpinHorner<2>(c,x);
+  case 3: return SpinHorner<3>(c,x);
+  case 4: return SpinHorner<4>(c,x);
+  default: return SpinHorner<kSpinMaxDeg>(c,x);
+  }
+}
+
+inline void SpinCoef(const SpinPdf& pdf, const Double_t* par, Double_t* c)
+{
+  for (Int_t k=0;k<=kSpinMaxDeg;k++) c[k] = 0.;
+  pdf.coef(par,c);
+}
+
+inline Double_t SpinEval(const SpinPdf& pdf, const Double_t* par, Double_t x)
+{
+  Double_t c[kSpinMaxDeg+1];
+  SpinCoef(pdf,par,c);
+  return par[0]*SpinPoly(c,pdf.deg,x);
+}
+
+// Functor to build a TF1 from a compiled pdf (no TFormula involved). The TF1 only has the npar
+// parameters of the pdf; the ones after them are constants of the case, given by parFixed.
+struct SpinPdfFunctor {
+  const SpinPdf* pdf;
+  Double_t parFixed;
+  SpinPdfFunctor(const SpinPdf* p, Double_t fixed) : pdf(p), parFixed(fixed) {}
+  Double_t operator()(const Double_t* x, const Double_t* par) const
+  {
+    Double_t p[kSpinMaxPar];
+    for (Int_t k=0;k<kSpinMaxPar;k++) p[k] = k<pdf->npar ? par[k] : parFixed;
+    return SpinEval(*pdf,p,x[0]);
+  }
+};
+
+// kTRUE if parameter ipar actually enters the pdf (the TF1 formulas sometimes skip [1])
+inline Bool_t SpinParUsed(const SpinPdf& pdf, Int_t ipar)
+{
+  Double_t par[kSpinMaxPar] = {1.,0.3,0.7};
+  Double_t c0[kSpinMaxDeg+1], c1[kSpinMaxDeg+1];
+  SpinCoef(pdf,par,c0);
+  par[ipar] += 0.5;
+  SpinCoef(pdf,par,c1);
+  for (Int_t k=0;k<=kSpinMaxDeg;k++)
+    if (c0[k]!=c1[k]) return kTRUE;
+  return kFALSE;
+}
+
+// kTRUE if the shape parameter ipar of pdf is fitted in case sc
+inline Bool_t SpinParFree(const SpinCase& sc, const SpinPdf& pdf, Int_t ipar, Bool_t doFitpol)
+{
+  return (doFitpol || !sc.canFix) && ipar<pdf.npar && SpinParUsed(pdf,ipar);
+}
+
+// Building blocks of the 6.4 distributions
+inline void SpinAddP2(Double_t* c, Double_t a) { c[0] -= a; c[2] += 3.*a; }                   // a*(3x^2-1)
+inline void SpinAddP4(Double_t* c, Double_t a) { c[0] += 3.*a; c[2] -= 30.*a; c[4] += 35.*a; } // a*(3-30x^2+35x^4)
+
+// Flat distribution "[0]*0.5"
+inline void SpinFlat(const Double_t*, Double_t* c) { c[0] = 0.5; }
+
+// 6.2: Omega, distributions with the asymmetry beta
+// "[0]*0.5*(1.+[1]*x)"
+inline void SpinOmega1(const Double_t* p, Double_t* c) { c[0] = 0.5; c[1] = 0.5*p[1]; }
+// "[0]*0.25*(1.+3.*pow(x,2)+[1]*x*(5.-9.*pow(x,2)))"
+inline void SpinOmega3(const Double_t* p, Double_t* c)
+{
+  c[0] = 0.25; c[2] = 0.75;
+  c[1] = 1.25*p[1]; c[3] = -2.25*p[1];
+}
+// "[0]*3./8.*(1.-2.*pow(x,2)+5.*pow(x,4)+[1]*x*(5.-26.*pow(x,2)+25.*pow(x,4)))"
+inline void SpinOmega5(const Double_t* p, Double_t* c)
+{
+  c[0] = 3./8.; c[2] = -6./8.; c[4] = 15./8.;
+  c[1] = 15./8.*p[1]; c[3] = -78./8.*p[1]; c[5] = 75./8.*p[1];
+}
+
+// 6.3: Lambda, spin 3/2 "[0]*(2*[1]+1)*0.25*(1.+3.*pow(x,2)*(1-[1]*2)/(2*[1]+1))"
+inline void SpinLambda3(const Double_t* p, Double_t* c) { c[0] = 0.25*(2.*p[1]+1.); c[2] = 0.75*(1.-2.*p[1]); }
+// 6.3: Lambda parity "[0]*0.5*(1-+[1]*x)", [1] the product of polarization and decay asymmetries
+// (0.45*0.61685*0.982 in the TFG). It is not a parameter of the fits, it comes from parFixed.
+inline void SpinParityMinus(const Double_t* p, Double_t* c) { c[0] = 0.5; c[1] = 0.5*p[1]; }
+inline void SpinParityPlus(const Double_t* p, Double_t* c) { c[0] = 0.5; c[1] = -0.5*p[1]; }
+
+// 6.4: b147 "[0]*(0.5+0.25*(3.*pow(x,2)-1))" and "[0]*(0.5-2/7.*(3.*pow(x,2)-1)+3./112.*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinB4(const Double_t*, Double_t* c) { c[0] = 0.5; SpinAddP2(c,0.25); }
+inline void SpinB7(const Double_t*, Double_t* c) { c[0] = 0.5; SpinAddP2(c,-2./7.); SpinAddP4(c,3./112.); }
+// b258 "[0]*0.5*(1+(1-4*[1])*0.5*(3.*pow(x,2)-1))" (also b369 pdf2)
+inline void SpinB5(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,0.25*(1.-4.*p[1])); }
+// "[0]*(0.5+(2-3*[1])*1/7.*(3.*pow(x,2)-1)+3*(1-5*[2])*1/56.*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinB8(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,(2.-3.*p[1])/7.); SpinAddP4(c,3.*(1.-5.*p[2])/56.); }
+// b369 "[0]*(0.5+2*(2-3*[1])*1./14.*(2*(2-3*[1]))*(3.*pow(x,2)-1)+3./56.*(1-5*[1]-[2])*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinB9(const Double_t* p, Double_t* c)
+{
+  c[0] = 0.5;
+  SpinAddP2(c,4./14.*(2.-3.*p[1])*(2.-3.*p[1]));
+  SpinAddP4(c,3./56.*(1.-5.*p[1]-p[2]));
+}
+// c123 "[0]*(0.5-0.25*[1]*(3.*pow(x,2)-1))" and "[0]*(0.5-[1]*0.5/7.*(3.*pow(x,2)-1)+[2]*3./112.*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinC2(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,-0.25*p[1]); }
+inline void SpinC3(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,-0.5/7.*p[1]); SpinAddP4(c,3./112.*p[2]); }
+// c456 "[0]*(0.5-[1]*1.25*0.25/7.*(3.*pow(x,2)-1)-[2]*0.25*3./112.*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinC6(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,-1.25*0.25/7.*p[1]); SpinAddP4(c,-0.25*3./112.*p[2]); }
+// c789 "[0]*(0.5-61/70.*0.25*[1]*(3.*pow(x,2)-1))" and "[0]*(0.5+[2]*3./112.*(3.-30.*pow(x,2)+35.*pow(x,4)))"
+inline void SpinC8(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP2(c,-61./70.*0.25*p[1]); }
+inline void SpinC9(const Double_t* p, Double_t* c) { c[0] = 0.5; SpinAddP4(c,3./112.*p[2]); }
+
+// Table of cases. To study a new spin combination add its coefficients above and a row here.
+const SpinCase kSpinCases[] = {
+  {"omega","6.2","cos#theta_{h}","analysisOmegabetalibre_exp","beta",10,770,kTRUE,kTRUE,0.,0.,kTRUE,1,3,
+   {{"pdf1","Esp\355n #frac{1}{2}",1,2,SpinOmega1},
+    {"pdf2","Esp\355n #frac{3}{2}",3,2,SpinOmega3},
+    {"pdf3","Esp\355n #frac{5}{2}",5,2,SpinOmega5}}},
+  {"lambda","6.3","cos#theta_{#Sigma^{+}}","analysisLambda_exp","beta",10,796,kTRUE,kFALSE,0.,0.15,kTRUE,0,2,
+   {{"pdf1","Esp\355n #frac{1}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{3}{2}",2,2,SpinLambda3}}},
+  {"paridad","6.3","cos#phi_{p}","analisisParidadLambda_exp","alpha",10,796,kFALSE,kFALSE,0.,0.45*0.61685*0.982,kTRUE,0,2,
+   {{"pdf1","Paridad #eta=-1",1,1,SpinParityMinus},
+    {"pdf2","Paridad #eta=+1",1,1,SpinParityPlus}}},
+  {"b147","6.4","cos#theta_{#Lambda_{c}}","coslambdab147_exp","pol",50,50000,kTRUE,kTRUE,0.05,0.05,kTRUE,0,3,
+   {{"pdf1","Esp\355n #frac{1}{2} #rightarrow #frac{1}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{1}{2} #rightarrow #frac{3}{2}",2,1,SpinB4},
+    {"pdf3","Esp\355n #frac{1}{2} #rightarrow #frac{5}{2}",4,1,SpinB7}}},
+  {"b258","6.4","cos#theta_{#Lambda_{c}}","coslambdab258_exp","pol",50,50000,kTRUE,kTRUE,0.,0.05,kFALSE,0,3,
+   {{"pdf1","Esp\355n #frac{3}{2} #rightarrow #frac{1}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{3}{2} #rightarrow #frac{3}{2}",2,2,SpinB5},
+    {"pdf3","Esp\355n #frac{3}{2} #rightarrow #frac{5}{2}",4,3,SpinB8}}},
+  {"b369","6.4","cos#theta_{#Lambda_{c}}","coslambdab369_exp","pol",50,50000,kTRUE,kTRUE,0.,0.05,kFALSE,0,3,
+   {{"pdf1","Esp\355n #frac{5}{2} #rightarrow #frac{1}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{5}{2} #rightarrow #frac{3}{2}",2,2,SpinB5},
+    {"pdf3","Esp\355n #frac{5}{2} #rightarrow #frac{5}{2}",4,3,SpinB9}}},
+  {"c123","6.4","cos#theta_{#Lambda_{b}}","coslambdac123_exp","pol",10,50000,kTRUE,kTRUE,0.05,0.05,kTRUE,0,3,
+   {{"pdf1","Esp\355n #frac{1}{2} #rightarrow #frac{1}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{3}{2} #rightarrow #frac{1}{2}",2,2,SpinC2},
+    {"pdf3","Esp\355n #frac{5}{2} #rightarrow #frac{1}{2}",4,3,SpinC3}}},
+  {"c456","6.4","cos#theta_{#Lambda_{b}}","coslambdac456_exp","pol",10,50000,kTRUE,kTRUE,0.05,0.05,kTRUE,0,3,
+   {{"pdf1","Esp\355n #frac{1}{2} #rightarrow #frac{3}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{3}{2} #rightarrow #frac{3}{2}",0,1,SpinFlat},
+    {"pdf3","Esp\355n #frac{5}{2} #rightarrow #frac{3}{2}",4,3,SpinC6}}},
+  {"c789","6.4","cos#theta_{#Lambda_{b}}","coslambdac789_exp","pol",10,50000,kTRUE,kTRUE,0.05,0.05,kTRUE,0,3,
+   {{"pdf1","Esp\355n #frac{1}{2} #rightarrow #frac{5}{2}",0,1,SpinFlat},
+    {"pdf2","Esp\355n #frac{3}{2} #rightarrow #frac{5}{2}",2,2,SpinC8},
+    {"pdf3","Esp\355n #frac{5}{2} #rightarrow #frac{5}{2}",4,3,SpinC9}}},
+};
+const Int_t kSpinNumCases = sizeof(kSpinCases)/sizeof(kSpinCases[0]);
+
+inline const SpinCase* SpinFindCase(const char* name)
+{
+  for (Int_t i=0;i<kSpinNumCases;i++)
+    if (!strcmp(kSpinCases[i].name,name)) return &kSpinCases[i];
+  return 0;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Results of the pseudoexperiments: one TTree entry per experiment with a
+// column per hypothesis and quantity (fit status, chi2, ndf, p-value,
+// parameters and errors) plus the seed, and a summary accumulated on the
+// fly in constant memory (Welford mean and variance, histogram of the
+// p-values).
+//
+// The tree is saved every chunk of experiments, so a run that stops can be
+// continued from its file, and files of runs with different seeds can be
+// read together with a TChain (or joined with hadd).
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINSTORE_H
+#define SPINSTORE_H
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "TFile.h"
+#include "TTree.h"
+#include "TString.h"
+#include "TMath.h"
+#include "SpinPdf.h"
+#include "SpinFit.h"
+
+// Result of one pseudoexperiment for every pdf of the case
+struct SpinExpResult {
+  Int_t iExp;
+  UInt_t seed;
+  SpinFitResult fit[kSpinMaxPdf];
+  Double_t tGen;  // seconds spent generating and fitting (not stored)
+  Double_t tFit;
+};
+
+// Running mean and variance (Welford)
+struct SpinStat {
+  Long64_t n;
+  Double_t mean;
+  Double_t m2;
+
+  SpinStat() : n(0), mean(0.), m2(0.) {}
+  void Add(Double_t x)
+  {
+    n++;
+    Double_t d = x-mean;
+    mean += d/n;
+    m2 += d*(x-mean);
+  }
+  Double_t Variance() const { return n>1 ? m2/(n-1) : 0.; }
+};
+
+// Quantiles of the p-values from a fixed histogram in log10(p), kPerDecade bins per decade from
+// 10^-kDecades to 1, so that the tiny p-values of the hypotheses far from the data keep their
+// order of magnitude. Smaller p-values (TMath::Prob gives 0 below ~1e-308) go to an underflow
+// bin and give the quantile 0.
+struct SpinQuantiles {
+  static const Int_t kDecades = 300;
+  static const Int_t kPerDecade = 100;
+  static const Int_t kBins = kDecades*kPerDecade;
+  Long64_t n;
+  Long64_t under;
+  std::vector<Long64_t> count;
+
+  SpinQuantiles() : n(0), under(0), count(kBins,0) {}
+  void Add(Double_t p)
+  {
+    n++;
+    if (!(p>=pow(10.,-kDecades))) {
+      under++;
+      return;
+    }
+    Int_t i = (Int_t)((log10(p)+kDecades)*kPerDecade);
+    count[i>=kBins ? kBins-1 : i]++;
+  }
+  Double_t Quantile(Double_t q) const
+  {
+    Double_t target = q*n, sum = under;
+    if (under>0 && sum>=target) return 0.;
+    for (Int_t i=0;i<kBins;i++) {
+      if (count[i]>0 && sum+count[i]>=target) return pow(10.,(i+(target-sum)/count[i])/kPerDecade-kDecades);
+      sum += count[i];
+    }
+    return 1.;
+  }
+};
+
+// One-sided significance of the p-value p
+inline Double_t SpinSigma(Double_t p)
+{
+  if (TMath::IsNaN(p)) return p;
+  return p>0. ? -TMath::NormQuantile(p) : TMath::Infinity();
+}
+
+// Summary of a run, filled experiment by experiment
+class SpinSummary {
+public:
+  SpinSummary(const SpinCase& sc, Bool_t doFit, Bool_t doFitpol) : fSc(&sc), fDoFit(doFit), fDoFitpol(doFitpol)
+  {
+    for (Int_t i=0;i<kSpinMaxPdf;i++) fNdof[i] = fFailed[i] = 0;
+    fN = 0;
+  }
+
+  // Fits that failed (status!=0) are counted apart and left out of the averages and quantiles
+  void Add(const SpinExpResult& r)
+  {
+    fN++;
+    for (Int_t i=0;i<fSc->npdf;i++) {
+      if (r.fit[i].status!=0) {
+        fFailed[i]++;
+        continue;
+      }
+      if (fChi2[i].n==0) fNdof[i] = r.fit[i].ndof;
+      fChi2[i].Add(r.fit[i].chi2);
+      fPvalue[i].Add(r.fit[i].pvalue);
+      for (Int_t k=1;k<fSc->pdf[i].npar;k++) fPar[i][k].Add(r.fit[i].par[k]);
+    }
+  }
+
+  Long64_t GetEntries() const { return fN; }
+
+  void Print() const
+  {
+    printf("\n");
+    for (Int_t i=0;i<fSc->npdf;i++) {
+      const char* name = fSc->pdf[i].name;
+      if (fFailed[i]>0) printf("Failed fits %s: %lld of %lld experiments\n",name,fFailed[i],fN);
+      if (fChi2[i].n==0) {
+        printf("\n");
+        continue;
+      }
+      for (Int_t k=1;k<fSc->pdf[i].npar;k++) {
+        if (!fDoFit || !fDoFitpol || !SpinParUsed(fSc->pdf[i],k)) continue;
+        printf("Average %s[%d] %s: %f +- %f\n",fSc->parName,k,name,fPar[i][k].mean,sqrt(fPar[i][k].Variance()));
+      }
+      Double_t chi2_mean = fChi2[i].mean;
+      printf("Average Chi2 / ndf %s: %f / %d --> p-value: %f\n",name,chi2_mean,fNdof[i],TMath::Prob(chi2_mean,fNdof[i]));
+      printf("p-value quantiles %s: 5%% %.3g, 50%% %.3g, 95%% %.3g\n\n",name,
+             fPvalue[i].Quantile(0.05),fPvalue[i].Quantile(0.5),fPvalue[i].Quantile(0.95));
+    }
+  }
+
+private:
+  const SpinCase* fSc;
+  Bool_t fDoFit;
+  Bool_t fDoFitpol;
+  Long64_t fN;
+  Long64_t fFailed[kSpinMaxPdf];
+  Int_t fNdof[kSpinMaxPdf];
+  SpinStat fChi2[kSpinMaxPdf];
+  SpinStat fPar[kSpinMaxPdf][kSpinMaxPar];
+  SpinQuantiles fPvalue[kSpinMaxPdf];
+};
+
+// Description of a run stored as the title of the tree. Experiments are only appended to a file
+// written with the same settings.
+inline TString SpinRunTitle(const SpinCase& sc, Int_t numEvts, Bool_t doFit, Bool_t doFitpol, Int_t seed, const char* gen, const char* fit)
+{
+  return TString::Format("%s numEvts=%d doFit=%d doFitpol=%d seed=%d gen=%s fit=%s",
+                         sc.name,numEvts,(Int_t)doFit,(Int_t)doFitpol,seed,gen,fit);
+}
+
+// Settings of a run from the title of its tree without the seed: runs that differ only in the
+// seed can be read together
+inline TString SpinRunSettings(const char* title)
+{
+  TString s(title);
+  Ssiz_t i = s.Index(" seed=");
+  if (i!=kNPOS) {
+    Ssiz_t j = s.Index(" ",i+1);
+    s.Remove(i,(j==kNPOS ? s.Length() : j)-i);
+  }
+  return s;
+}
+
+// Tree "toys" with one column per quantity, bound to one SpinExpResult for writing and reading
+class SpinStore {
+public:
+  SpinStore() : fFile(0), fTree(0) {}
+  ~SpinStore() { Close(); }
+
+  // Opens fileName, creating the tree if it is not there. Returns kFALSE if the file holds a
+  // run with other settings.
+  Bool_t Open(const char* fileName, const SpinCase& sc, const char* title)
+  {
+    fFile = TFile::Open(fileName,"UPDATE");
+    if (!fFile || fFile->IsZombie()) {
+      printf("Cannot open %s\n",fileName);
+      return kFALSE;
+    }
+    fTree = (TTree*)fFile->Get("toys");
+    Bool_t exists = fTree!=0;
+    if (exists && strcmp(fTree->GetTitle(),title)) {
+      printf("%s holds another run: %s\n",fileName,fTree->GetTitle());
+      fTree = 0;
+      return kFALSE;
+    }
+    if (!exists) fTree = new TTree("toys",title);
+    Bind(fTree,sc,fRec,!exists);
+    return kTRUE;
+  }
+
+  // Binds the columns of tree to r (creating them if create)
+  static void Bind(TTree* tree, const SpinCase& sc, SpinExpResult& r, Bool_t create)
+  {
+    Column(tree,"iExp",&r.iExp,"iExp/I",create);
+    Column(tree,"seed",&r.seed,"seed/i",create);
+    for (Int_t i=0;i<sc.npdf;i++) {
+      const char* name = sc.pdf[i].name;
+      Int_t npar = sc.pdf[i].npar;
+      SpinFitResult& f = r.fit[i];
+      TString col(name);
+      Column(tree,col+"_status",&f.status,col+"_status/I",create);
+      Column(tree,col+"_chi2",&f.chi2,col+"_chi2/D",create);
+      Column(tree,col+"_ndof",&f.ndof,col+"_ndof/I",create);
+      Column(tree,col+"_pvalue",&f.pvalue,col+"_pvalue/D",create);
+      Column(tree,col+"_par",f.par,TString::Format("%s_par[%d]/D",name,npar),create);
+      Column(tree,col+"_err",f.err,TString::Format("%s_err[%d]/D",name,npar),create);
+    }
+  }
+
+  Long64_t GetEntries() const { return fTree->GetEntries(); }
+  const SpinExpResult& Read(Long64_t entry) { fTree->GetEntry(entry); return fRec; }
+  void Fill(const SpinExpResult& r) { fRec = r; fTree->Fill(); }
+  void Save() { fTree->AutoSave("SaveSelf"); }
+
+  void Close()
+  {
+    if (!fFile) return;
+    if (fTree) {
+      fFile->cd();
+      fTree->Write("",TObject::kOverwrite);
+    }
+    fFile->Close(); // deletes the tree
+    delete fFile;
+    fFile = 0;
+    fTree = 0;
+  }
+
+private:
+  static void Column(TTree* tree, const char* name, void* address, const char* leaflist, Bool_t create)
+  {
+    if (create) tree->Branch(name,address,leaflist);
+    else tree->SetBranchAddress(name,address);
+  }
+
+  TFile* fFile;
+  TTree* fTree;
+  SpinExpResult fRec;
+};
+
+#endif
@@ -0,0 +1,299 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Unbinned extended maximum likelihood fit of the spin pdfs to the
+// individual cos(theta) values of an experiment.
+//
+// -lnL(N,p) = N - n ln N - sum_i ln g(x_i;p) + n ln I(p), with g the pdf
+// polynomial and I its integral in [-1,1]. N and the shape parameters
+// separate: N = n with error sqrt(n), and p comes from Newton iterations
+// on the shape term. The events and the per-event values of g and of its
+// derivatives are columns of a SpinEvents buffer, and every pass over them
+// is a plain loop over contiguous arrays that the compiler vectorizes.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef SPINUNBINNED_H
+#define SPINUNBINNED_H
+
+#include <math.h>
+#include <vector>
+#include "SpinPdf.h"
+#include "SpinGen.h"
+#include "SpinFit.h"
+
+// Events of one experiment as a structure of arrays: cos(theta) and the work columns of the fit
+struct SpinEvents {
+  Int_t n;
+  std::vector<Double_t> x;
+  std::vector<Double_t> g;                     // pdf polynomial at x
+  std::vector<Double_t> dg[kSpinMaxPar];       // derivatives with respect to the free parameters
+  std::vector<Double_t> d2g[kSpinMaxPar];      // second derivatives, (j,l) with l<=j at j*(j+1)/2+l
+
+  SpinEvents() : n(0) {}
+  void Resize(Int_t size)
+  {
+    n = size;
+    x.resize(n);
+  }
+  // Work columns of the unbinned fit: g, the derivatives of nfree parameters and the second
+  // derivatives that do not vanish (second[j*(j+1)/2+l])
+  void ResizeWork(Int_t nfree, const Bool_t* second)
+  {
+    g.resize(n);
+    for (Int_t j=0;j<nfree;j++) dg[j].resize(n);
+    for (Int_t s=0;s<nfree*(nfree+1)/2;s++)
+      if (second[s]) d2g[s].resize(n);
+  }
+};
+
+// out[i] = polynomial c of degree deg at x[i]. The degree is a template parameter, so the Horner
+// steps stay in registers and the loop over the events vectorizes.
+template<Int_t Deg>
+inline void SpinPolyKernelDeg(const Double_t* c, const Double_t* x, Int_t n, Double_t* out)
+{
+  Double_t cc[Deg+1];
+  for (Int_t k=0;k<=Deg;k++) cc[k] = c[k];
+  for (Int_t i=0;i<n;i++) out[i] = SpinHorner<Deg>(cc,x[i]);
+}
+
+inline void SpinPolyKernel(const Double_t* c, Int_t deg, const Double_t* x, Int_t n, Double_t* out)
+{
+  switch (deg) {
+  case 0: SpinPolyKernelDeg<0>(c,x,n,out); break;
+  case 1: SpinPolyKernelDeg<1>(c,x,n,out); break;
+  case 2: SpinPolyKernelDeg<2>(c,x,n,out); break;
+  case 3: SpinPolyKernelDeg<3>(c,x,n,out); break;
+  case 4: SpinPolyKernelDeg<4>(c,x,n,out); break;
+  default: SpinPolyKernelDeg<kSpinMaxDeg>(c,x,n,out);
+  }
+}
+
+const Int_t kSpinLanes = 4; // independent partial sums, one per SIMD lane
+
+// sum_i a[i]
+inline Double_t SpinSumKernel(const Double_t* a, Int_t n)
+{
+  Double_t s[kSpinLanes] = {0.};
+  Int_t i = 0;
+  for (;i+kSpinLanes<=n;i+=kSpinLanes)
+    for (Int_t l=0;l<kSpinLanes;l++) s[l] += a[i+l];
+  for (;i<n;i++) s[0] += a[i];
+  return (s[0]+s[1])+(s[2]+s[3]);
+}
+
+// sum_i a[i]*b[i]
+inline Double_t SpinDotKernel(const Double_t* a, const Double_t* b, Int_t n)
+{
+  Double_t s[kSpinLanes] = {0.};
+  Int_t i = 0;
+  for (;i+kSpinLanes<=n;i+=kSpinLanes)
+    for (Int_t l=0;l<kSpinLanes;l++) s[l] += a[i+l]*b[i+l];
+  for (;i<n;i++) s[0] += a[i]*b[i];
+  return (s[0]+s[1])+(s[2]+s[3]);
+}
+
+// sum_i ln a[i], or -HUGE_VAL if some a[i]<=0. Each lane multiplies kSpinLogBlock values before
+// taking one logarithm, and keeps their minimum: an even number of negative values gives a
+// positive product. A block with some value not positive (or NaN) or whose product leaves the
+// normal range is summed value by value.
+const Int_t kSpinLogBlock = 8;
+inline Double_t SpinLogSumKernel(const Double_t* a, Int_t n)
+{
+  const Int_t block = kSpinLanes*kSpinLogBlock;
+  Double_t s = 0.;
+  Int_t i = 0;
+  for (;i+block<=n;i+=block) {
+    Double_t prod[kSpinLanes] = {1.,1.,1.,1.}, lo[kSpinLanes] = {1.,1.,1.,1.};
+    for (Int_t j=0;j<block;j+=kSpinLanes)
+      for (Int_t l=0;l<kSpinLanes;l++) {
+        prod[l] *= a[i+j+l];
+        lo[l] = a[i+j+l]<lo[l] ? a[i+j+l] : lo[l];
+      }
+    for (Int_t l=0;l<kSpinLanes;l++) {
+      if (lo[l]>0. && prod[l]>1e-300 && prod[l]<1e300) s += log(prod[l]);
+      else
+        for (Int_t j=l;j<block;j+=kSpinLanes) {
+          if (!(a[i+j]>0.)) return -HUGE_VAL;
+          s += log(a[i+j]);
+        }
+    }
+  }
+  for (;i<n;i++) {
+    if (!(a[i]>0.)) return -HUGE_VAL;
+    s += log(a[i]);
+  }
+  return s;
+}
+
+const Double_t kSpinEdm = 1e-7; // expected decrease of -lnL at convergence (Minuit stops at ~1e-5)
+
+class SpinUnbinnedFitter {
+public:
+  SpinUnbinnedFitter() : fNpdf(0) {}
+
+  // Same free parameters as SpinFitter (SpinParFree)
+  SpinUnbinnedFitter(const SpinCase& sc, Bool_t doFitpol) : fNpdf(sc.npdf), fParStart(sc.parStart)
+  {
+    for (Int_t ip=0;ip<fNpdf;ip++) {
+      Hyp& h = fHyp[ip];
+      h.pdf = &sc.pdf[ip];
+      h.nfree = 0;
+      h.par[0] = 1.;
+      for (Int_t k=1;k<kSpinMaxPar;k++) {
+        h.par[k] = sc.parFixed;
+        if (SpinParFree(sc,*h.pdf,k,doFitpol)) h.free[h.nfree++] = k;
+      }
+      // The coefficients are at most quadratic: their second derivatives are constants
+      Double_t c[kSpinMaxDeg+1], dc[kSpinMaxPar][kSpinMaxDeg+1], d2c[kSpinMaxPar][kSpinMaxPar][kSpinMaxDeg+1];
+      SpinCoefDerivs(*h.pdf,h.par,h.free,h.nfree,c,dc,d2c);
+      for (Int_t j=0;j<h.nfree;j++)
+        for (Int_t l=0;l<=j;l++) {
+          Bool_t& second = h.second[j*(j+1)/2+l];
+          second = kFALSE;
+          for (Int_t k=0;k<=h.pdf->deg;k++) if (d2c[j][l][k]!=0.) second = kTRUE;
+        }
+    }
+  }
+
+  // Fits every pdf to the events, starting from the fit to the histogram counts. scale converts
+  // the number of events into the normalization of the binned fits (the bin width), so that par[0]
+  // means the same. The goodness of fit is the Baker-Cousins chi2 of the histogram at the fitted
+  // parameters (binned.Chisquare), with one degree of freedom less per fitted parameter.
+  void Fit(SpinEvents& ev, Double_t scale, const SpinFitter& binned, const Double_t* counts, Int_t nbins, SpinFitResult* res) const
+  {
+    SpinFitResult start[kSpinMaxPdf];
+    binned.Fit(counts,ev.n*scale,start);
+    for (Int_t ip=0;ip<fNpdf;ip++) {
+      const Hyp& h = fHyp[ip];
+      const Int_t nf = h.nfree;
+      ev.ResizeWork(nf,h.second);
+      Double_t p[kSpinMaxPar], grad[kSpinMaxPar], H[kSpinMaxPar][kSpinMaxPar];
+      for (Int_t j=0;j<nf;j++) p[j] = start[ip].par[h.free[j]];
+      Double_t f = Eval(h,ev,p,grad,H);
+      if (f>=1e30) {  // some event outside the pdf of the binned fit
+        for (Int_t j=0;j<nf;j++) p[j] = fParStart;
+        f = Eval(h,ev,p,grad,H);
+      }
+      Int_t status = f>=1e30 ? kSpinFitInvalid : (nf>0 ? kSpinFitNoConverge : kSpinFitOk);
+      for (Int_t it=0;it<100 && status==kSpinFitNoConverge;it++) {
+        Double_t step[kSpinMaxPar];
+        Double_t edm = SpinNewtonStep(nf,H,grad,step);
+        if (edm<0.) break;
+        if (edm<kSpinEdm) {  // last Newton step, the Hessian here gives the errors
+          for (Int_t a=0;a<nf;a++) p[a] += step[a];
+          status = kSpinFitOk;
+          break;
+        }
+        // the full step is taken with its derivatives, the backtracking only needs -lnL
+        Double_t t = 1., pnew[kSpinMaxPar], gnew[kSpinMaxPar], Hnew[kSpinMaxPar][kSpinMaxPar];
+        for (Int_t a=0;a<nf;a++) pnew[a] = p[a]+step[a];
+        Double_t fnew = Eval(h,ev,pnew,gnew,Hnew);
+        if (fnew<=f) {
+          std::copy(gnew,gnew+nf,grad);
+          for (Int_t a=0;a<nf;a++) std::copy(Hnew[a],Hnew[a]+nf,H[a]);
+        } else {
+          for (Int_t ls=0;ls<30 && fnew>f;ls++) {
+            t *= 0.5;
+            for (Int_t a=0;a<nf;a++) pnew[a] = p[a]+t*step[a];
+            fnew = Eval(h,ev,pnew,0,Hnew);
+          }
+          if (fnew>f) {  // no decrease left along the Newton direction
+            status = kSpinFitOk;
+            break;
+          }
+          fnew = Eval(h,ev,pnew,grad,H);
+        }
+        std::copy(pnew,pnew+nf,p);
+        f = fnew;
+      }
+
+      SpinFitResult& fr = res[ip];
+      Double_t cov[kSpinMaxPar][kSpinMaxPar], dummy[kSpinMaxPar] = {0.};
+      for (Int_t a=0;a<nf;a++)
+        for (Int_t b=0;b<nf;b++) cov[a][b] = H[a][b];
+      if (nf>0 && !SpinSolve(nf,cov,dummy))
+        for (Int_t a=0;a<nf;a++)
+          for (Int_t b=0;b<nf;b++) cov[a][b] = 0.;
+      std::copy(h.par,h.par+kSpinMaxPar,fr.par);
+      for (Int_t k=0;k<kSpinMaxPar;k++) fr.err[k] = 0.;
+      fr.par[0] = ev.n*scale;
+      fr.err[0] = sqrt((Double_t)ev.n)*scale;
+      for (Int_t j=0;j<nf;j++) {
+        fr.par[h.free[j]] = p[j];
+        fr.err[h.free[j]] = sqrt(fabs(cov[j][j]));
+      }
+      fr.chi2 = binned.Chisquare(ip,counts,fr.par);
+      fr.ndof = nbins-nf-1;
+      fr.pvalue = TMath::Prob(fr.chi2,fr.ndof);
+      fr.status = status;
+      if (status==kSpinFitInvalid || fr.chi2==TMath::Infinity()) SpinFitInvalid(fr);
+    }
+  }
+
+private:
+  struct Hyp {
+    const SpinPdf* pdf;
+    Int_t nfree;
+    Int_t free[kSpinMaxPar];     // indices of the free shape parameters
+    Double_t par[kSpinMaxPar];   // fixed values
+    Bool_t second[kSpinMaxPar];  // second derivative (j,l) not zero, at j*(j+1)/2+l
+  };
+
+  Int_t fNpdf;
+  Double_t fParStart;
+  Hyp fHyp[kSpinMaxPdf];
+
+  // Shape part of -lnL at the free parameters p, with gradient and Hessian if grad!=0:
+  //   S = -sum ln g_i + n ln I
+  //   dS/dp_j = -sum g'_j/g + n I_j/I
+  //   d2S/dp_j dp_l = sum (g'_j g'_l/g^2 - g''_jl/g) + n (I_jl/I - I_j I_l/I^2)
+  Double_t Eval(const Hyp& h, SpinEvents& ev, const Double_t* p, Double_t* grad, Double_t H[kSpinMaxPar][kSpinMaxPar]) const
+  {
+    const Int_t n = ev.n, nf = h.nfree, deg = h.pdf->deg;
+    Double_t par[kSpinMaxPar], c[kSpinMaxDeg+1];
+    Double_t dc[kSpinMaxPar][kSpinMaxDeg+1], d2c[kSpinMaxPar][kSpinMaxPar][kSpinMaxDeg+1];
+    std::copy(h.par,h.par+kSpinMaxPar,par);
+    for (Int_t j=0;j<nf;j++) par[h.free[j]] = p[j];
+    if (!grad) SpinCoef(*h.pdf,par,c);
+    else {
+      SpinCoefDerivs(*h.pdf,par,h.free,nf,c,dc,d2c);
+      for (Int_t a=0;a<nf;a++) {
+        grad[a] = 0.;
+        for (Int_t b=0;b<nf;b++) H[a][b] = 0.;
+      }
+    }
+
+    Double_t I = SpinIntegral(c,deg,-1.,1.);
+    if (!(I>0.)) return 1e30;
+    SpinPolyKernel(c,deg,ev.x.data(),n,ev.g.data());
+    Double_t logsum = SpinLogSumKernel(ev.g.data(),n);
+    if (logsum==-HUGE_VAL) return 1e30;
+    Double_t S = -logsum + n*log(I);
+    if (!grad) return S;
+
+    // 1/g in g, u_j = g'_j/g in dg[j], g''_jl in d2g
+    Double_t* g = ev.g.data();
+    for (Int_t i=0;i<n;i++) g[i] = 1./g[i];
+    Double_t Ij[kSpinMaxPar];
+    for (Int_t j=0;j<nf;j++) {
+      Double_t* u = ev.dg[j].data();
+      SpinPolyKernel(dc[j],deg,ev.x.data(),n,u);
+      for (Int_t i=0;i<n;i++) u[i] *= g[i];
+      Ij[j] = SpinIntegral(dc[j],deg,-1.,1.)/I;
+      grad[j] = -SpinSumKernel(u,n) + n*Ij[j];
+    }
+    for (Int_t j=0;j<nf;j++)
+      for (Int_t l=0;l<=j;l++) {
+        H[j][l] = SpinDotKernel(ev.dg[j].data(),ev.dg[l].data(),n) - n*Ij[j]*Ij[l];
+        if (h.second[j*(j+1)/2+l]) {  // g'' vanishes for the pdfs linear in the parameters
+          Double_t* v = ev.d2g[j*(j+1)/2+l].data();
+          SpinPolyKernel(d2c[j][l],deg,ev.x.data(),n,v);
+          H[j][l] += -SpinDotKernel(v,g,n) + n*SpinIntegral(d2c[j][l],deg,-1.,1.)/I;
+        }
+        H[l][j] = H[j][l];
+      }
+    return S;
+  }
+};
+
+#endif